@@ -0,0 +1,58 @@
+#ifndef FREEZE_FREEZE_ARENA_H_
+#define FREEZE_FREEZE_ARENA_H_
+
+#include <cassert>
+#include <cstdint>
+#include <cstring>
+#include <memory>
+
+namespace freeze {
+
+// Bump allocator over a single cache-line aligned block.
+// A default-constructed arena only measures: Allocate() returns nullptr and
+// accumulates the size, so a layout can be computed by carving it twice,
+// once to measure and once, after Reset(), for real.
+class Arena {
+ public:
+  static const size_t kAlignment = 64;
+
+  static size_t Align(size_t bytes) {
+    return (bytes + kAlignment - 1) & ~(kAlignment - 1);
+  }
+
+  // Allocates `capacity` zeroed bytes and rewinds the arena.
+  void Reset(size_t capacity) {
+    storage_.reset(new unsigned char[capacity + kAlignment]);
+    auto address = reinterpret_cast<std::uintptr_t>(storage_.get());
+    data_ = storage_.get() + (Align(address) - address);
+    std::memset(data_, 0, capacity);
+    capacity_ = capacity;
+    size_ = 0;
+  }
+
+  template <typename T>
+  T* Allocate(size_t count) {
+    size_t offset = size_;
+    size_ += Align(count * sizeof(T));
+    if (data_ == nullptr) {
+      return nullptr;
+    }
+    assert(size_ <= capacity_);
+    return reinterpret_cast<T*>(data_ + offset);
+  }
+
+  // Bytes carved so far.
+  size_t size() const { return size_; }
+  // Bytes reserved by the last Reset().
+  size_t capacity() const { return capacity_; }
+
+ private:
+  std::unique_ptr<unsigned char[]> storage_;
+  unsigned char* data_ = nullptr;
+  size_t capacity_ = 0;
+  size_t size_ = 0;
+};
+
+}  // namespace freeze
+
+#endif  // FREEZE_FREEZE_ARENA_H_
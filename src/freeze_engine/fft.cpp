@@ -1,6 +1,7 @@
 #include <cstring>
 #include <iostream>
 
+#include "arena.h"
 #include "fft.h"
 #include "fftw3.h"
 
@@ -29,7 +30,25 @@ FFT::~FFT() {
   fftwf_destroy_plan(impl_->backward_plan);
 }
 
-void FFT::Init(size_t nfft, const std::string& wisdom) {
+// Aligned byte sizes of the real and complex workspace buffers.
+struct WorkspaceLayout {
+  size_t real_bytes;
+  size_t cplx_bytes;
+};
+
+WorkspaceLayout MakeWorkspaceLayout(size_t nfft) {
+  return {Arena::Align(nfft * sizeof(float)),
+          Arena::Align((nfft / 2 + 1) * sizeof(fftwf_complex))};
+}
+
+size_t FFT::WorkspaceSize(size_t nfft) {
+  auto layout = MakeWorkspaceLayout(nfft);
+  return 2 * layout.real_bytes + 2 * layout.cplx_bytes;
+}
+
+size_t FFT::StateSize() { return sizeof(FFT::Impl); }
+
+void FFT::Init(size_t nfft, const std::string& wisdom, void* workspace) {
   impl_->nfft = nfft;
 
   auto fftw_flags = FFTW_WISDOM_ONLY | FFTW_MEASURE;
@@ -40,17 +59,25 @@ void FFT::Init(size_t nfft, const std::string& wisdom) {
               << ". Using estimate instead." << std::endl;
   }
 
+  // buffers are laid out in execution order: forward in/out, backward in/out
+  auto layout = MakeWorkspaceLayout(nfft);
+  auto real_bytes = layout.real_bytes;
+  auto cplx_bytes = layout.cplx_bytes;
+  auto ptr = static_cast<unsigned char*>(workspace);
+  impl_->forward_in = reinterpret_cast<float*>(ptr);
+  impl_->forward_out = reinterpret_cast<fftwf_complex*>(ptr + real_bytes);
+  impl_->backward_in =
+      reinterpret_cast<fftwf_complex*>(ptr + real_bytes + cplx_bytes);
+  impl_->backward_out =
+      reinterpret_cast<float*>(ptr + real_bytes + 2 * cplx_bytes);
+
   // forward plan
-  impl_->forward_in = new float[nfft];
-  impl_->forward_out = new fftwf_complex[nfft/2 + 1];
   impl_->forward_plan = fftwf_plan_dft_r2c_1d(impl_->nfft,
                                               impl_->forward_in,
                                               impl_->forward_out,
                                               fftw_flags);
 
   // backward plan
-  impl_->backward_in = new fftwf_complex[nfft/2 + 1];
-  impl_->backward_out = new float[nfft];
   impl_->backward_plan = fftwf_plan_dft_c2r_1d(impl_->nfft,
                                                impl_->backward_in,
                                                impl_->backward_out,
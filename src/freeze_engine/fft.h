@@ -3,13 +3,20 @@
 
 #include <complex>
 #include <memory>
+#include <string>
 
 namespace freeze {
 class FFT {
  public:
   FFT();
   ~FFT();
-  void Init(size_t nfft, const std::string& wisdom);
+  // Bytes of workspace Init() expects for an `nfft` points transform.
+  static size_t WorkspaceSize(size_t nfft);
+  // Bytes of private state the constructor allocates on the heap.
+  static size_t StateSize();
+  // `workspace` must hold WorkspaceSize(nfft) bytes, be aligned on
+  // Arena::kAlignment and outlive this object. It is not owned.
+  void Init(size_t nfft, const std::string& wisdom, void* workspace);
   void Forward(float* input, std::complex<float>* output);
   void Inverse(std::complex<float>* input, float* output);
 
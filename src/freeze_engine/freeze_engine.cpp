@@ -1,6 +1,8 @@
 #include "freeze_engine.h"
 
+#include <cassert>
 #include <cmath>
+#include <cstring>
 // On windows, M_PI isn't define if cmath is included without _USE_MATH_DEFINES.
 // Defining it here if it isn't already is a more portable way of doing
 #ifndef M_PI
@@ -9,106 +11,86 @@
 
 #include <Eigen/Core>
 //#include <unsupported/Eigen/FFT>
+#include "arena.h"
 #include "fft.h"
 
 namespace freeze {
 
 // Helpers
-using Matrix = Eigen::MatrixXf;
-using CplxMatrix = Eigen::MatrixXcf;
 using Vector = Eigen::VectorXf;
+using VectorMap = Eigen::Map<Vector>;
+using Complex = std::complex<float>;
 
 const size_t kMaxBufferLen = 2048;
+const float kTwoPi = 2 * M_PI;
 
 struct Freezer::Parameters {
-  Matrix input;
+  // All buffers below are carved from `arena` by Carve(), in the order a hop
+  // touches them. Multichannel buffers are stored channel after channel.
+  Arena arena;
 
-  // params that has to be initialized
-  Matrix sliding_buffer;
-  Matrix output_buffer;
-  CplxMatrix fourier_transform;
-  Vector window;
+  float* sliding_buffer;  // buffer_length per channel
+  float* window;          // nfft
+  float* frame;           // nfft, analysis then synthesis scratch
+  void* fft_workspace;
+  Complex* fourier_transform;  // bin_number per channel
+  Complex* previous_fourier_transform;
 
-  // params that can be initialized at runtime
-  CplxMatrix previous_fourier_transform;
-  Matrix dphi;
-  Matrix freeze_ft_magnitude;
-  Matrix total_dphi;
+  // freeze state, set on the first frame after Enable()
+  float* total_dphi;  // bin_number per channel
+  float* dphi;
+  float* freeze_ft_magnitude;
+  Complex* modified_fft;  // bin_number
+
+  float* output_buffer;  // buffer_length per channel
 
   size_t channel_number;
   size_t nfft;
+  size_t bin_number;
+  size_t buffer_length;
   size_t hop_size;
   size_t index_sliding;
+  size_t input_frames;  // written but not yet read
 
   bool is_on;
   bool first_on;
   bool just_on;
 
   FFT fft;
-  //  Eigen::FFT<float> fft;
+
+  void Carve() {
+    auto state_size = channel_number * bin_number;
+    sliding_buffer = arena.Allocate<float>(channel_number * buffer_length);
+    window = arena.Allocate<float>(nfft);
+    frame = arena.Allocate<float>(nfft);
+    fft_workspace = arena.Allocate<unsigned char>(FFT::WorkspaceSize(nfft));
+    fourier_transform = arena.Allocate<Complex>(state_size);
+    previous_fourier_transform = arena.Allocate<Complex>(state_size);
+    total_dphi = arena.Allocate<float>(state_size);
+    dphi = arena.Allocate<float>(state_size);
+    freeze_ft_magnitude = arena.Allocate<float>(state_size);
+    modified_fft = arena.Allocate<Complex>(bin_number);
+    output_buffer = arena.Allocate<float>(channel_number * buffer_length);
+  }
 };
 
-Vector MakeSqrtHanningWindow(size_t length) {
-  Vector output = Vector::Zero(length);
+void MakeSqrtHanningWindow(size_t length, float* output) {
   for (size_t index = 0; index < length; index++) {
     output[index] =
         sqrt(0.5 - 0.5 * cos(2 * M_PI * (static_cast<float>(index) / length)));
   }
-  return output;
-}
-
-void ShiftBuffer(Matrix* buffer, int shift) {
-  assert(shift < 0);
-  // copy end of buffer at the beginning
-  for (Matrix::Index col = 0; col < buffer->cols() - std::abs(shift); col++) {
-    memcpy(buffer->data() + (col * buffer->rows()),
-           buffer->data() + ((col + std::abs(shift)) * buffer->rows()),
-           buffer->rows() * sizeof(float));
-  }
-  // set zeros at the end
-  buffer
-      ->block(0, buffer->cols() - std::abs(shift), buffer->rows(),
-              std::abs(shift))
-      .setZero();
-}
-
-Matrix Angle(const CplxMatrix& input) {
-  Matrix output(input.rows(), input.cols());
-  size_t count = input.cols() * input.rows();
-  for (size_t index = 0; index < count; index++) {
-    output(index) = std::arg(input(index));
-  }
-  return output;
-}
-Matrix Abs(const CplxMatrix& input) {
-  Matrix output(input.rows(), input.cols());
-  size_t count = input.cols() * input.rows();
-  for (size_t index = 0; index < count; index++) {
-    output(index) = std::abs(input(index));
-  }
-  return output;
-}
-CplxMatrix Exp(const CplxMatrix& input) {
-  CplxMatrix output(input.rows(), input.cols());
-  size_t count = input.cols() * input.rows();
-  for (size_t index = 0; index < count; index++) {
-    output(index) = std::exp(input(index));
-  }
-  return output;
-}
-CplxMatrix j(const Matrix& input) {
-  CplxMatrix output(input.rows(), input.cols());
-  size_t count = input.cols() * input.rows();
-  for (size_t index = 0; index < count; index++) {
-    output(index) = std::complex<float>(0, input(index));
-  }
-  return output;
 }
 
-void InplaceModulo(Matrix* matrix, float value) {
-  size_t count = matrix->cols() * matrix->rows();
-  for (size_t index = 0; index < count; index++) {
-    (*matrix)(index) = std::fmod((*matrix)(index), value);
+void ShiftBuffer(float* buffer, size_t channel_number, size_t length,
+                 size_t shift) {
+  assert(shift <= length);
+  for (size_t channel = 0; channel < channel_number; channel++) {
+    auto channel_buffer = buffer + channel * length;
+    // copy end of buffer at the beginning
+    memmove(channel_buffer, channel_buffer + shift,
+            (length - shift) * sizeof(float));
+    // set zeros at the end
+    memset(channel_buffer + length - shift, 0, shift * sizeof(float));
   }
 }
 
@@ -117,28 +99,25 @@ Freezer::Freezer() : params_(std::make_shared<Parameters>()) {}
 
 void Freezer::Init(size_t channel_number, const std::string& wisdom,
                    size_t fft_size, float overlap_rate) {
-  // initialize input values
-  params_->input.resize(channel_number, 0);
-
-  // Init parameters
-  params_->sliding_buffer =
-      Matrix::Zero(channel_number, (fft_size + kMaxBufferLen));
-  params_->output_buffer =
-      Matrix::Zero(channel_number, (fft_size + kMaxBufferLen));
-  params_->fourier_transform =
-      CplxMatrix::Zero(fft_size / 2 + 1, channel_number);
-  params_->previous_fourier_transform =
-      CplxMatrix::Zero(fft_size / 2 + 1, channel_number);
-  params_->window = MakeSqrtHanningWindow(fft_size);
-
   params_->channel_number = channel_number;
   params_->nfft = fft_size;
+  params_->bin_number = fft_size / 2 + 1;
+  params_->buffer_length = fft_size + kMaxBufferLen;
   params_->hop_size = static_cast<size_t>(fft_size * (1.0 - overlap_rate));
   params_->index_sliding = fft_size - params_->hop_size;
+  params_->input_frames = 0;
   params_->is_on = false;
   params_->first_on = false;
   params_->just_on = false;
-  params_->fft.Init(fft_size, wisdom);
+
+  // measure the layout, then allocate and carve it for real
+  params_->arena = Arena();
+  params_->Carve();
+  params_->arena.Reset(params_->arena.size());
+  params_->Carve();
+
+  MakeSqrtHanningWindow(fft_size, params_->window);
+  params_->fft.Init(fft_size, wisdom, params_->fft_workspace);
 }
 
 void Freezer::Write(const std::vector<float>& data, std::error_code& err) {
@@ -151,101 +130,113 @@ void Freezer::Write(const std::vector<float>& data, std::error_code& err) {
     return;
   }
 
-  // get new input size
-  auto current_frame_number = params_->input.cols();
+  // input goes straight to the sliding buffer, after what is pending
+  auto first_frame = params_->index_sliding + params_->input_frames;
   auto extra_frame_number = data.size() / channel_number;
-
-  // resize
-  params_->input.conservativeResize(channel_number,
-                                    current_frame_number + extra_frame_number);
+  if (first_frame + extra_frame_number > params_->buffer_length) {
+    err = std::make_error_code(std::errc::no_buffer_space);
+    return;
+  }
 
   // fill
-  for (size_t col = current_frame_number; col < extra_frame_number; col++) {
-    for (size_t row = 0; row < channel_number; row++) {
-      params_->input(row, col) =
-          data[(col - current_frame_number) * channel_number + row];
+  for (size_t row = 0; row < channel_number; row++) {
+    auto channel_buffer =
+        params_->sliding_buffer + row * params_->buffer_length + first_frame;
+    for (size_t col = 0; col < extra_frame_number; col++) {
+      channel_buffer[col] = data[col * channel_number + row];
     }
   }
+  params_->input_frames += extra_frame_number;
 }
 
 std::vector<float> Freezer::Read(std::error_code& err) {
   std::lock_guard<std::mutex> guard(mutex_);
 
-  auto buffer_length = params_->input.cols();
+  auto channel_number = params_->channel_number;
+  auto nfft = params_->nfft;
+  auto bin_number = params_->bin_number;
+  auto buffer_length = params_->buffer_length;
+  auto input_length = params_->input_frames;
 
   // slide output
-  ShiftBuffer(&(params_->output_buffer), -buffer_length);
-
-  params_->sliding_buffer.block(0, params_->index_sliding,
-                                params_->channel_number, buffer_length) =
-      params_->input;
-  params_->index_sliding += buffer_length;
+  ShiftBuffer(params_->output_buffer, channel_number, buffer_length,
+              input_length);
 
   // input is being processed
-  params_->input.resize(params_->channel_number, 0);
+  params_->index_sliding += input_length;
+  params_->input_frames = 0;
+
+  VectorMap window(params_->window, nfft);
+  VectorMap frame(params_->frame, nfft);
 
   size_t out_buffer_offset = 0;  // for input buffer greater than nfft
-  while (params_->index_sliding >= params_->nfft) {
-    params_->previous_fourier_transform = params_->fourier_transform;
+  while (params_->index_sliding >= nfft) {
+    // the transform of the last hop becomes the previous one
+    std::swap(params_->fourier_transform,
+              params_->previous_fourier_transform);
 
     // fft
-    for (size_t channel = 0; channel < params_->channel_number; channel++) {
-      auto analyzed_buffer =
-          params_->sliding_buffer.block(channel, 0, 1, params_->nfft);
-      Vector windowed_buffer =
-          analyzed_buffer.transpose().array() * params_->window.array();
-
-      //      auto fourier_at_channel = params_->fourier_transform.col(channel);
-      //      fourier_at_channel = params_->fft.fwd(windowed_buffer,
-      //      params_->nfft);
-      auto ptr = params_->fourier_transform.data();
-      auto first_idx = channel * params_->fourier_transform.rows();
-      params_->fft.Forward(windowed_buffer.data(), ptr + first_idx);
+    for (size_t channel = 0; channel < channel_number; channel++) {
+      VectorMap analyzed_buffer(
+          params_->sliding_buffer + channel * buffer_length, nfft);
+      frame = analyzed_buffer.array() * window.array();
+      params_->fft.Forward(params_->frame,
+                           params_->fourier_transform + channel * bin_number);
     }
 
     // get freeze parameters
+    auto state_size = channel_number * bin_number;
     if (params_->just_on) {
-      params_->total_dphi = Angle(params_->fourier_transform);
-      params_->dphi =
-          params_->total_dphi - Angle(params_->previous_fourier_transform);
-      params_->freeze_ft_magnitude = Abs(params_->fourier_transform);
+      for (size_t index = 0; index < state_size; index++) {
+        params_->total_dphi[index] = std::arg(params_->fourier_transform[index]);
+        params_->dphi[index] =
+            params_->total_dphi[index] -
+            std::arg(params_->previous_fourier_transform[index]);
+        params_->freeze_ft_magnitude[index] =
+            std::abs(params_->fourier_transform[index]);
+      }
       params_->just_on = false;
     }
 
     // update output if is_on
     if (params_->first_on) {//params_->is_on
-      params_->total_dphi += params_->dphi;
-      InplaceModulo(&(params_->total_dphi), 2 * M_PI);
-
-      // modify output
-      CplxMatrix modified_fft = params_->freeze_ft_magnitude.array() *
-                                Exp(j(params_->total_dphi)).array();
-
-      for (size_t channel = 0; channel < params_->channel_number; channel++) {
-        auto ptr = modified_fft.data();
-        auto first_idx = channel * modified_fft.rows();
-        Vector inverse_fourier(params_->nfft);
-        params_->fft.Inverse(ptr + first_idx, inverse_fourier.data());
+      for (size_t channel = 0; channel < channel_number; channel++) {
+        auto total_dphi = params_->total_dphi + channel * bin_number;
+        auto dphi = params_->dphi + channel * bin_number;
+        auto magnitude = params_->freeze_ft_magnitude + channel * bin_number;
+
+        // modify output
+        for (size_t bin = 0; bin < bin_number; bin++) {
+          total_dphi[bin] = std::fmod(total_dphi[bin] + dphi[bin], kTwoPi);
+          params_->modified_fft[bin] =
+              std::polar(magnitude[bin], total_dphi[bin]);
+        }
+        params_->fft.Inverse(params_->modified_fft, params_->frame);
 
         // get the right block
-        auto output_block = params_->output_buffer.block(
-            channel, out_buffer_offset, 1, params_->nfft);
-
-        Matrix windowed_synthesis =
-            inverse_fourier.real().array() * params_->window.array();
-        output_block += windowed_synthesis.transpose();
+        VectorMap output_block(params_->output_buffer +
+                                   channel * buffer_length + out_buffer_offset,
+                               nfft);
+        output_block += (frame.array() * window.array()).matrix();
       }
 
       out_buffer_offset += params_->hop_size;
     }
 
-    ShiftBuffer(&(params_->sliding_buffer), -params_->hop_size);
+    ShiftBuffer(params_->sliding_buffer, channel_number, buffer_length,
+                params_->hop_size);
     params_->index_sliding -= params_->hop_size;
   }
 
-  auto output_data = params_->output_buffer.data();
-  return std::vector<float>(
-      output_data, output_data + (buffer_length * params_->channel_number));
+  // interleave channels
+  std::vector<float> output(input_length * channel_number);
+  for (size_t row = 0; row < channel_number; row++) {
+    auto channel_buffer = params_->output_buffer + row * buffer_length;
+    for (size_t col = 0; col < input_length; col++) {
+      output[col * channel_number + row] = channel_buffer[col];
+    }
+  }
+  return output;
 }
 
 void Freezer::Enable() {
@@ -263,4 +254,13 @@ void Freezer::Disable() {
 
 bool Freezer::IsEnabled() const { return params_->is_on; }
 
+size_t Freezer::MemoryFootprint() const {
+  auto arena_bytes = params_->arena.capacity();
+  if (arena_bytes > 0) {
+    arena_bytes += Arena::kAlignment;  // slack used to align the block
+  }
+  return sizeof(Freezer) + sizeof(Parameters) + FFT::StateSize() +
+         arena_bytes;
+}
+
 }  // namespace freeze
@@ -5,6 +5,7 @@
 #include <system_error>
 #include <vector>
 #include <memory>
+#include <string>
 
 namespace freeze {
 
@@ -21,6 +22,12 @@ class Freezer {
   void Disable();
   bool IsEnabled() const;
 
+  // Bytes held by this instance once Init() has been called: the state arena,
+  // the Freezer's own fields and the FFT private state. Not counted: FFTW
+  // plans, owned by FFTW, and the shared_ptr control blocks of Parameters and
+  // of the FFT private state.
+  size_t MemoryFootprint() const;
+
  private:
   std::mutex mutex_;
 